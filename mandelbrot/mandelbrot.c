@@ -13,6 +13,11 @@
 //
 // The parameters PLATFORMNUM and GPUNUM represent the OpenCL platform and GPU
 // device that we wish to use.
+//
+// If ANTIALIAS is set, pixels whose iteration count differs from that of a
+// neighbour by more than AA_THRESHOLD are found on the device, and only these
+// pixels are then recalculated as the mean of AA_SAMPLES*AA_SAMPLES jittered
+// sub-pixel samples.
 
 
 #include <stdio.h>
@@ -43,6 +48,12 @@
 
 #define DOUBLE_PRECISION 1
 
+// adaptive antialiasing: on/off, samples per side of an edge pixel and the
+// iteration count difference to a neighbour above which a pixel is an edge
+#define ANTIALIAS 1
+#define AA_SAMPLES 4
+#define AA_THRESHOLD 2
+
 // a callback function to report on any errors that occur within the context
 void errorCallback(const char * errorString, const void *privateInfo, size_t cb, void *userData){
     printf("Error message:\n%s\n",errorString);
@@ -186,6 +197,7 @@ int main(int argc, char **argv){
     }
 
     cl_kernel kernel;
+    cl_kernel aaKernel;
     int nx, ny;
     int *output;
     cl_mem outputBuffer;
@@ -214,7 +226,7 @@ int main(int argc, char **argv){
         output = malloc(sizeof(int)*nx*ny);
     
         // // tell OpenCL to use the above array as output from the GPU.
-        outputBuffer = clCreateBuffer(context,CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR,sizeof(int)*NX*NY,(void*) output,&ierr);
+        outputBuffer = clCreateBuffer(context,CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,sizeof(int)*NX*NY,(void*) output,&ierr);
         if (ierr != CL_SUCCESS){
             printf("An error occurred creating the output buffer!\n");
             return 1;
@@ -265,6 +277,27 @@ int main(int argc, char **argv){
             return 1;
         }
 
+        if (ANTIALIAS){
+            //select the antialiasing kernel. Its first 7 args are the same as the kernel above
+            aaKernel = clCreateKernel(program,"mandelbrot_aa",&ierr);
+            if (ierr != CL_SUCCESS){
+                printf("An error occurred creating the antialiasing kernel!\n");
+                return 1;
+            }
+
+            ierr  = clSetKernelArg(aaKernel,0,sizeof(cl_mem),(void *) &outputBuffer);
+            ierr |= clSetKernelArg(aaKernel,1,sizeof(float),&xmin);
+            ierr |= clSetKernelArg(aaKernel,2,sizeof(float),&xmax);
+            ierr |= clSetKernelArg(aaKernel,3,sizeof(float),&ymin);
+            ierr |= clSetKernelArg(aaKernel,4,sizeof(float),&ymax);
+            ierr |= clSetKernelArg(aaKernel,5,sizeof(int),&nx);
+            ierr |= clSetKernelArg(aaKernel,6,sizeof(int),&ny);
+            if (ierr != CL_SUCCESS){
+                printf("An error occurred setting the args for the antialiasing kernel!\n");
+                return 1;
+            }
+        }
+
     } else {
 
         printf("Using double precision calculations\n");
@@ -289,7 +322,7 @@ int main(int argc, char **argv){
         output = malloc(sizeof(int)*nx*ny);
     
         // // tell OpenCL to use the above array as output from the GPU.
-        outputBuffer = clCreateBuffer(context,CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR,sizeof(int)*NX*NY,(void*) output,&ierr);
+        outputBuffer = clCreateBuffer(context,CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,sizeof(int)*NX*NY,(void*) output,&ierr);
         if (ierr != CL_SUCCESS){
             printf("An error occurred creating the output buffer!\n");
             return 1;
@@ -339,6 +372,27 @@ int main(int argc, char **argv){
             printf("An error occurred setting arg6 for the kernel!\n");
             return 1;
         }
+
+        if (ANTIALIAS){
+            //select the antialiasing kernel. Its first 7 args are the same as the kernel above
+            aaKernel = clCreateKernel(program,"mandelbrot_aa_double",&ierr);
+            if (ierr != CL_SUCCESS){
+                printf("An error occurred creating the antialiasing kernel!\n");
+                return 1;
+            }
+
+            ierr  = clSetKernelArg(aaKernel,0,sizeof(cl_mem),(void *) &outputBuffer);
+            ierr |= clSetKernelArg(aaKernel,1,sizeof(double),&xmin);
+            ierr |= clSetKernelArg(aaKernel,2,sizeof(double),&xmax);
+            ierr |= clSetKernelArg(aaKernel,3,sizeof(double),&ymin);
+            ierr |= clSetKernelArg(aaKernel,4,sizeof(double),&ymax);
+            ierr |= clSetKernelArg(aaKernel,5,sizeof(int),&nx);
+            ierr |= clSetKernelArg(aaKernel,6,sizeof(int),&ny);
+            if (ierr != CL_SUCCESS){
+                printf("An error occurred setting the args for the antialiasing kernel!\n");
+                return 1;
+            }
+        }
     }
 
     
@@ -366,11 +420,88 @@ int main(int argc, char **argv){
         printf("An error occurred enqueueing the task!\n");
         return 1;
     }
+
+    //the event the copy back to the host must wait on
+    cl_event lastEvent = event;
+
+
+    //antialiasing: find the edge pixels then supersample only these
+    cl_kernel edgeKernel;
+    cl_mem flaggedBuffer, countBuffer;
+    cl_event edgeEvent, aaEvent;
+    int nflagged = 0;
+
+    if (ANTIALIAS){
+        int nsub = AA_SAMPLES;
+        int threshold = AA_THRESHOLD;
+
+        edgeKernel = clCreateKernel(program,"mandelbrot_edges",&ierr);
+        if (ierr != CL_SUCCESS){
+            printf("An error occurred creating the edge detection kernel!\n");
+            return 1;
+        }
+
+        //list of flagged pixels (at most every pixel) and the number of them (starting at 0)
+        flaggedBuffer = clCreateBuffer(context,CL_MEM_READ_WRITE,sizeof(int)*NX*NY,NULL,&ierr);
+        if (ierr != CL_SUCCESS){
+            printf("An error occurred creating the flagged pixel buffer!\n");
+            return 1;
+        }
+        countBuffer = clCreateBuffer(context,CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,sizeof(int),(void*) &nflagged,&ierr);
+        if (ierr != CL_SUCCESS){
+            printf("An error occurred creating the flagged pixel count buffer!\n");
+            return 1;
+        }
+
+        ierr  = clSetKernelArg(edgeKernel,0,sizeof(cl_mem),(void *) &outputBuffer);
+        ierr |= clSetKernelArg(edgeKernel,1,sizeof(cl_mem),(void *) &flaggedBuffer);
+        ierr |= clSetKernelArg(edgeKernel,2,sizeof(cl_mem),(void *) &countBuffer);
+        ierr |= clSetKernelArg(edgeKernel,3,sizeof(int),&nx);
+        ierr |= clSetKernelArg(edgeKernel,4,sizeof(int),&ny);
+        ierr |= clSetKernelArg(edgeKernel,5,sizeof(int),&threshold);
+        if (ierr != CL_SUCCESS){
+            printf("An error occurred setting the args for the edge detection kernel!\n");
+            return 1;
+        }
+
+        ierr  = clSetKernelArg(aaKernel,7,sizeof(cl_mem),(void *) &flaggedBuffer);
+        ierr |= clSetKernelArg(aaKernel,8,sizeof(int),&nsub);
+        if (ierr != CL_SUCCESS){
+            printf("An error occurred setting the args for the antialiasing kernel!\n");
+            return 1;
+        }
+
+        //the edge detection pass runs over the whole image, once the image is complete
+        ierr = clEnqueueNDRangeKernel(queue,edgeKernel,2,NULL,global_work_size,NULL,1,&event,&edgeEvent);
+        if (ierr != CL_SUCCESS){
+            printf("An error occurred enqueueing the edge detection task!\n");
+            return 1;
+        }
+        lastEvent = edgeEvent;
+
+        //we need the number of flagged pixels to size the antialiasing launch
+        ierr = clEnqueueReadBuffer(queue,countBuffer,CL_TRUE,0,sizeof(int),(void *) &nflagged,1,&edgeEvent,NULL);
+        if (ierr != CL_SUCCESS){
+            printf("An error occurred getting the flagged pixel count!\n");
+            return 1;
+        }
+
+        //one work item per flagged pixel
+        if (nflagged > 0){
+            size_t aa_work_size[] = { nflagged };
+            ierr = clEnqueueNDRangeKernel(queue,aaKernel,1,NULL,aa_work_size,NULL,1,&edgeEvent,&aaEvent);
+            if (ierr != CL_SUCCESS){
+                printf("An error occurred enqueueing the antialiasing task!\n");
+                return 1;
+            }
+            lastEvent = aaEvent;
+        }
+    }
     
     
     //get results back
     cl_event copyEvent;
-    ierr = clEnqueueReadBuffer(queue,outputBuffer,CL_TRUE,0,sizeof(int)*NX*NY,(void *) output,1,&event,&copyEvent);
+    ierr = clEnqueueReadBuffer(queue,outputBuffer,CL_TRUE,0,sizeof(int)*NX*NY,(void *) output,1,&lastEvent,&copyEvent);
     if (ierr != CL_SUCCESS){
         printf("An error occurred getting the output buffer!\n");
         return 1;
@@ -392,6 +523,19 @@ int main(int argc, char **argv){
     } else {
         printf("Time to complete calculation: %f ms\n",(tstop-tstart)/1.E6);
     }
+
+    // the time taken for the edge detection and supersampling
+    if (ANTIALIAS){
+        printf("Antialiased %d of %d pixels (%.2f%%)\n",nflagged,NX*NY,100.*nflagged/(NX*NY));
+
+        ierr = clGetEventProfilingInfo(edgeEvent,CL_PROFILING_COMMAND_START,sizeof(cl_ulong),&tstart,NULL);
+        ierr |= clGetEventProfilingInfo(lastEvent,CL_PROFILING_COMMAND_END,sizeof(cl_ulong),&tstop,NULL);
+        if (ierr != CL_SUCCESS) {
+            printf("Could not get the antialiasing profiling info\n");
+        } else {
+            printf("Time to complete antialiasing: %f ms\n",(tstop-tstart)/1.E6);
+        }
+    }
     
     // same thing but the time taken to copy the data off the GPU
     ierr = clGetEventProfilingInfo(copyEvent,CL_PROFILING_COMMAND_START,sizeof(cl_ulong),&tstart,NULL);
@@ -435,6 +579,12 @@ int main(int argc, char **argv){
     fclose(f);
 
     
+    if (ANTIALIAS){
+        clReleaseKernel(edgeKernel);
+        clReleaseKernel(aaKernel);
+        clReleaseMemObject(flaggedBuffer);
+        clReleaseMemObject(countBuffer);
+    }
     clReleaseKernel(kernel); //Release kernel.
 	clReleaseProgram(program); //Release the program object.
 	clReleaseMemObject(outputBuffer); //Release the output buffer
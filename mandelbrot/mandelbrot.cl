@@ -1,20 +1,7 @@
 #pragma OPENCL EXTENSION cl_khr_fp64 : enable
 
-//Calculates the Mandelbrot set 
-
-//output: out (the image array)
-//inputs: xmin, xmax, ymin, ymax - x and y limits of the image
-//inputs:  nx, ny number of points in x and y
-
-__kernel void mandelbrot(__global int *out, __private float xmin, __private float xmax, __private float ymin, __private float ymax, __private int nx, __private int ny){
-    //coords of thhis kernel instance
-    int idx = get_global_id(1);
-    int idy = get_global_id(0);
-    
-    //get the x0 and y0 values
-    float x0 = xmin + (xmax-xmin)/nx * idx;
-    float y0 = ymin + (ymax-ymin)/ny * idy;
-
+//Returns the number of iterations before the point x0 + iy0 diverges (up to 256)
+int iterate(float x0, float y0){
     float x = 0.;
     float y = 0.;
 
@@ -37,20 +24,12 @@ __kernel void mandelbrot(__global int *out, __private float xmin, __private floa
         n+=1;
     }
 
-    out[idx + nx*idy] = n;
-
+    return n;
 }
 
 
-__kernel void mandelbrot_double(__global int *out, __private double xmin, __private double xmax, __private double ymin, __private double ymax, __private int nx, __private int ny){
-    //coords of thhis kernel instance
-    int idx = get_global_id(1);
-    int idy = get_global_id(0);
-    
-    //get the x0 and y0 values
-    double x0 = xmin + (xmax-xmin)/nx * idx;
-    double y0 = ymin + (ymax-ymin)/ny * idy;
-
+//Returns the number of iterations before the point x0 + iy0 diverges (up to 256)
+int iterate_double(double x0, double y0){
     double x = 0.;
     double y = 0.;
 
@@ -73,6 +52,136 @@ __kernel void mandelbrot_double(__global int *out, __private double xmin, __priv
         n+=1;
     }
 
-    out[idx + nx*idy] = n;
+    return n;
+}
+
+
+//Calculates the Mandelbrot set 
+
+//output: out (the image array)
+//inputs: xmin, xmax, ymin, ymax - x and y limits of the image
+//inputs:  nx, ny number of points in x and y
+
+__kernel void mandelbrot(__global int *out, __private float xmin, __private float xmax, __private float ymin, __private float ymax, __private int nx, __private int ny){
+    //coords of thhis kernel instance
+    int idx = get_global_id(1);
+    int idy = get_global_id(0);
+    
+    //get the x0 and y0 values
+    float x0 = xmin + (xmax-xmin)/nx * idx;
+    float y0 = ymin + (ymax-ymin)/ny * idy;
+
+    out[idx + nx*idy] = iterate(x0,y0);
+
+}
+
+
+__kernel void mandelbrot_double(__global int *out, __private double xmin, __private double xmax, __private double ymin, __private double ymax, __private int nx, __private int ny){
+    //coords of thhis kernel instance
+    int idx = get_global_id(1);
+    int idy = get_global_id(0);
+    
+    //get the x0 and y0 values
+    double x0 = xmin + (xmax-xmin)/nx * idx;
+    double y0 = ymin + (ymax-ymin)/ny * idy;
+
+    out[idx + nx*idy] = iterate_double(x0,y0);
+
+}
+
+
+//Flags pixels whose iteration count differs from a neighbour's by more than threshold.
+//The flagged pixels' indices are compacted into a list for the antialiasing kernels
+
+//input: in (the image array from the mandelbrot kernel)
+//outputs: flagged (list of flagged pixel indices), count (number of flagged pixels - must be zeroed beforehand)
+//inputs: nx, ny number of points in x and y
+//input: threshold - the iteration count difference above which a pixel is considered an edge
+
+__kernel void mandelbrot_edges(__global const int *in, __global int *flagged, __global int *count, __private int nx, __private int ny, __private int threshold){
+    //coords of this kernel instance
+    int idx = get_global_id(1);
+    int idy = get_global_id(0);
+
+    int n = in[idx + nx*idy];
+
+    //compare against the four nearest neighbours (where they exist)
+    int edge = 0;
+    if (idx > 0)    edge |= abs(n - in[idx-1 + nx*idy]) > threshold;
+    if (idx < nx-1) edge |= abs(n - in[idx+1 + nx*idy]) > threshold;
+    if (idy > 0)    edge |= abs(n - in[idx + nx*(idy-1)]) > threshold;
+    if (idy < ny-1) edge |= abs(n - in[idx + nx*(idy+1)]) > threshold;
+
+    if (edge){
+        //reserve a slot in the list
+        flagged[atomic_inc(count)] = idx + nx*idy;
+    }
+}
+
+
+//Returns a pseudorandom number in [0,1) from a seed (an integer hash)
+float jitter(uint seed){
+    seed = (seed ^ 61) ^ (seed >> 16);
+    seed *= 9;
+    seed = seed ^ (seed >> 4);
+    seed *= 0x27d4eb2d;
+    seed = seed ^ (seed >> 15);
+    return (seed & 0xFFFFFF) / 16777216.0f;
+}
+
+
+//Supersamples the pixels flagged by mandelbrot_edges, overwriting them with the mean iteration count.
+//Each pixel is sampled on an nsub*nsub grid, with each sample jittered within its sub-pixel cell.
+//This is a 1D kernel with one instance per flagged pixel
+
+//output: out (the image array)
+//inputs: xmin, xmax, ymin, ymax - x and y limits of the image
+//inputs:  nx, ny number of points in x and y
+//inputs: flagged (list of pixel indices to supersample), nsub (number of samples per side of a pixel)
+
+__kernel void mandelbrot_aa(__global int *out, __private float xmin, __private float xmax, __private float ymin, __private float ymax, __private int nx, __private int ny, __global const int *flagged, __private int nsub){
+    int pixel = flagged[get_global_id(0)];
+    int idx = pixel % nx;
+    int idy = pixel / nx;
+
+    float dx = (xmax-xmin)/nx;
+    float dy = (ymax-ymin)/ny;
+
+    int sum = 0;
+
+    //the sub-pixel grid covers the cell centred on the original sample point
+    for (int j=0;j<nsub;j++){
+        for (int i=0;i<nsub;i++){
+            uint seed = 2*(pixel*nsub*nsub + j*nsub + i);
+            float x0 = xmin + dx * (idx + (i + jitter(seed))/nsub - 0.5f);
+            float y0 = ymin + dy * (idy + (j + jitter(seed+1))/nsub - 0.5f);
+            sum += iterate(x0,y0);
+        }
+    }
+
+    out[pixel] = (sum + nsub*nsub/2)/(nsub*nsub);
+}
+
+
+__kernel void mandelbrot_aa_double(__global int *out, __private double xmin, __private double xmax, __private double ymin, __private double ymax, __private int nx, __private int ny, __global const int *flagged, __private int nsub){
+    int pixel = flagged[get_global_id(0)];
+    int idx = pixel % nx;
+    int idy = pixel / nx;
 
-}
\ No newline at end of file
+    double dx = (xmax-xmin)/nx;
+    double dy = (ymax-ymin)/ny;
+
+    int sum = 0;
+
+    //the sub-pixel grid covers the cell centred on the original sample point
+    for (int j=0;j<nsub;j++){
+        for (int i=0;i<nsub;i++){
+            uint seed = 2*(pixel*nsub*nsub + j*nsub + i);
+            double x0 = xmin + dx * (idx + (i + jitter(seed))/nsub - 0.5);
+            double y0 = ymin + dy * (idy + (j + jitter(seed+1))/nsub - 0.5);
+            sum += iterate_double(x0,y0);
+        }
+    }
+
+    out[pixel] = (sum + nsub*nsub/2)/(nsub*nsub);
+}